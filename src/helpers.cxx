@@ -1,17 +1,21 @@
 #include "helpers.hxx"
 
-#include <wincodec.h>
-
 #include <wil/com.h>
 #include <wil/result.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <format>
 #include <print>
+#include <spanstream>
+#include <stdexcept>
 
 namespace helpers
 {
-auto getPaths(int argc, char* argv[]) -> std::pair<fs::path, fs::path>
+auto getPaths(const Options& options) -> std::pair<fs::path, fs::path>
 {
-    std::vector<std::string> args(argv + 1, argc + argv);
+    const auto& args{options.arguments};
 
     std::pair<fs::path, fs::path> paths;
 
@@ -38,34 +42,326 @@ auto getPaths(int argc, char* argv[]) -> std::pair<fs::path, fs::path>
     return paths;
 }
 
-auto getBitmap(fs::path inputFileCanonical, int size) -> std::vector<char>
+auto getOptions(int argc, char* argv[]) -> Options
 {
-    wil::com_ptr<IWICBitmapDecoder> pDecoder;
-    wil::com_ptr<IWICBitmapFrameDecode> pFrameDecode;
-    wil::com_ptr<IWICBitmapEncoder> pEncoder;
-    wil::com_ptr<IWICBitmapFrameEncode> pFrameEncode;
-    wil::com_ptr<IWICFormatConverter> pFormatter;
-    wil::com_ptr<IWICBitmapScaler> pScaler;
-    wil::com_ptr<IWICStream> pStream;
-    wil::com_ptr<IPropertyBag2> pPropertyBag;
+    std::vector<std::string> args(argv + 1, argc + argv);
+
+    Options options;
+
+    if (!args.empty() && args.front() == "serve")
+    {
+        options.mode = Mode::Serve;
+        args.erase(args.begin());
+    }
+    else if (!args.empty() && args.front() == "client")
+    {
+        options.mode = Mode::Client;
+        args.erase(args.begin());
+    }
+    else if (!args.empty() && args.front() == "batch")
+    {
+        options.mode = Mode::Batch;
+        args.erase(args.begin());
+    }
+
+    auto getValue{[&](size_t& i) -> std::string
+                  {
+                      if (i + 1 >= args.size())
+                      {
+                          std::println("Missing value for option: {}", args[i]);
+                          std::exit(EXIT_FAILURE);
+                      }
+
+                      return args[++i];
+                  }};
+
+    auto getNumber{[&](size_t& i) -> int
+                   {
+                       auto option{args[i]};
+                       auto value{getValue(i)};
+
+                       try
+                       {
+                           auto number{std::stoi(value)};
+
+                           if (number > 0)
+                           {
+                               return number;
+                           }
+                       }
+                       catch (const std::exception& e)
+                       {
+                       }
+
+                       std::println("Invalid value for option {}: {}", option, value);
+                       std::exit(EXIT_FAILURE);
+                   }};
+
+    // Accepts a byte count with an optional K, M or G suffix.
+    auto getBytes{[&](size_t& i) -> uint64_t
+                  {
+                      auto option{args[i]};
+                      auto value{getValue(i)};
+
+                      try
+                      {
+                          size_t position{0};
+                          auto bytes{std::stoull(value, &position)};
+                          auto suffix{value.substr(position)};
+
+                          if (suffix == "K" || suffix == "k")
+                          {
+                              bytes <<= 10;
+                          }
+                          else if (suffix == "M" || suffix == "m")
+                          {
+                              bytes <<= 20;
+                          }
+                          else if (suffix == "G" || suffix == "g")
+                          {
+                              bytes <<= 30;
+                          }
+                          else if (!suffix.empty())
+                          {
+                              bytes = 0;
+                          }
+
+                          if (bytes > 0)
+                          {
+                              return bytes;
+                          }
+                      }
+                      catch (const std::exception& e)
+                      {
+                      }
+
+                      std::println("Invalid value for option {}: {}", option, value);
+                      std::exit(EXIT_FAILURE);
+                  }};
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        const auto& arg{args[i]};
+
+        if (arg == "--write-if-changed")
+        {
+            options.writeIfChanged = true;
+        }
+        else if (arg == "--socket")
+        {
+            options.socket = getValue(i);
+        }
+        else if (arg == "--workers")
+        {
+            options.workers = getNumber(i);
+        }
+        else if (arg == "--memory-limit")
+        {
+            options.memoryLimit = getBytes(i);
+        }
+        else if (arg == "--bytes")
+        {
+            options.sendBytes = true;
+        }
+        else if (arg == "--bench")
+        {
+            options.requests = getNumber(i);
+        }
+        else if (arg == "--concurrency")
+        {
+            options.concurrency = getNumber(i);
+        }
+        else if (arg.starts_with("--"))
+        {
+            std::println("Unknown option: {}", arg);
+            std::exit(EXIT_FAILURE);
+        }
+        else
+        {
+            options.arguments.push_back(arg);
+        }
+    }
+
+    if ((options.mode == Mode::Serve || options.mode == Mode::Client) && options.socket.empty())
+    {
+        std::println("No socket specified");
+        std::exit(EXIT_FAILURE);
+    }
+
+    return options;
+}
 
+auto getIcon(fs::path inputFileCanonical) -> std::vector<char>
+{
     auto pFactory{
         wil::CoCreateInstance<IWICImagingFactory>(CLSID_WICImagingFactory, CLSCTX_INPROC_SERVER)};
 
+    auto pDecoder{getDecoder(pFactory.get(), inputFileCanonical)};
+
+    auto pSource{getSource(pFactory.get(), pDecoder.get())};
+
+    return getIcon(pFactory.get(), pSource.get());
+}
+
+auto getIcon(IWICImagingFactory* pFactory, IWICBitmapSource* pSource) -> std::vector<char>
+{
+    std::vector<std::vector<char>> bitmaps;
+
+    for (auto bitmapSize : bitmapSizes)
+    {
+        bitmaps.push_back(getBitmap(pFactory, pSource, bitmapSize));
+    }
+
+    std::vector<uint32_t> sizes;
+    sizes.reserve(bitmaps.size());
+    for (auto const& bitmap : bitmaps)
+    {
+        sizes.push_back(static_cast<uint32_t>(bitmap.size()));
+    }
+
+    uint16_t count{static_cast<uint16_t>(bitmapSizes.size())};
+    uint32_t offset{6 + (16 * static_cast<uint32_t>(count))};
+
+    std::vector<uint32_t> positions;
+    positions.push_back(offset);
+    auto cumulate{offset};
+    for (auto i = 0; i < sizes.size(); ++i)
+    {
+        cumulate += sizes[i];
+        positions.push_back(cumulate);
+    }
+
+    // Entry dimensions are the pixel size, 256 is stored as 0.
+    std::vector<uint8_t> dimensions;
+    dimensions.reserve(bitmapSizes.size());
+    for (const auto& bitmapSize : bitmapSizes)
+    {
+        dimensions.push_back(static_cast<uint8_t>(bitmapSize));
+    }
+
+    // Assemble straight into the final buffer, it ends where the last bitmap ends.
+    std::vector<char> icon(positions.back());
+    std::ospanstream outputStream(std::span<char>(icon), std::ios::binary);
+
+    writeHeader(outputStream, count);
+
+    for (int i = 0; i < static_cast<int>(bitmapSizes.size()); i++)
+    {
+        writeEntry(outputStream, bitmaps[i], dimensions[i], positions[i]);
+    }
+
+    for (int i = 0; i < static_cast<int>(bitmapSizes.size()); i++)
+    {
+        writeBitmap(outputStream, bitmaps[i]);
+    }
+
+    return icon;
+}
+
+auto getDecoder(IWICImagingFactory* pFactory, fs::path inputFileCanonical)
+    -> wil::com_ptr<IWICBitmapDecoder>
+{
+    wil::com_ptr<IWICBitmapDecoder> pDecoder;
+
     THROW_IF_FAILED(pFactory->CreateDecoderFromFilename(inputFileCanonical.wstring().c_str(), NULL,
                                                         GENERIC_READ,
                                                         WICDecodeMetadataCacheOnDemand, &pDecoder));
 
+    return pDecoder;
+}
+
+auto getDecoder(IWICImagingFactory* pFactory, const std::vector<char>& bytes)
+    -> wil::com_ptr<IWICBitmapDecoder>
+{
+    wil::com_ptr<IWICStream> pStream;
+    wil::com_ptr<IWICBitmapDecoder> pDecoder;
+
+    THROW_IF_FAILED(pFactory->CreateStream(&pStream));
+    THROW_IF_FAILED(
+        pStream->InitializeFromMemory(reinterpret_cast<BYTE*>(const_cast<char*>(bytes.data())),
+                                      static_cast<DWORD>(bytes.size())));
+    THROW_IF_FAILED(pFactory->CreateDecoderFromStream(pStream.get(), NULL,
+                                                      WICDecodeMetadataCacheOnDemand, &pDecoder));
+
+    return pDecoder;
+}
+
+auto getFootprint(IWICBitmapDecoder* pDecoder) -> uint64_t
+{
+    wil::com_ptr<IWICBitmapFrameDecode> pFrameDecode;
+
+    THROW_IF_FAILED(pDecoder->GetFrame(0, &pFrameDecode));
+
+    // Reads the frame header only, nothing is decoded yet.
+    UINT width{0};
+    UINT height{0};
+    THROW_IF_FAILED(pFrameDecode->GetSize(&width, &height));
+
+    uint64_t bytesPerPixel{4};
+    uint64_t largest{static_cast<uint64_t>(bitmapSizes.front())};
+
+    // Worst case PNG size for incompressible pixels: a filter byte per row, stored deflate
+    // blocks of at most 64 KiB, IDAT chunks of at least 8 KiB and the fixed chunks around them.
+    auto getPngBound{[&](uint64_t size)
+                     {
+                         auto raw{size * ((size * bytesPerPixel) + 1)};
+                         auto deflate{raw + (((raw / 65535) + 1) * 5) + 6};
+                         return deflate + (((deflate / 8192) + 1) * 12) + 1024;
+                     }};
+
+    // Decoded source bitmap.
+    uint64_t footprint{uint64_t{width} * height * bytesPerPixel};
+
+    // The scaler's internal buffers are undocumented, budget a float row buffer for the
+    // largest size. Then the scaled pixels and encoder stream of the largest size.
+    footprint += uint64_t{height} * largest * bytesPerPixel * sizeof(float);
+    footprint += (largest * largest * bytesPerPixel) + getPngBound(largest);
+
+    // Encoded bitmaps and the icon assembled from them.
+    for (auto size : bitmapSizes)
+    {
+        footprint += 2 * getPngBound(static_cast<uint64_t>(size));
+    }
+
+    return footprint;
+}
+
+auto getSource(IWICImagingFactory* pFactory, IWICBitmapDecoder* pDecoder)
+    -> wil::com_ptr<IWICBitmap>
+{
+    wil::com_ptr<IWICBitmapFrameDecode> pFrameDecode;
+    wil::com_ptr<IWICFormatConverter> pFormatter;
+    wil::com_ptr<IWICBitmap> pBitmap;
+
     THROW_IF_FAILED(pDecoder->GetFrame(0, &pFrameDecode));
 
+    // Decode once into a cached bitmap, every size is scaled from it.
+    THROW_IF_FAILED(pFactory->CreateFormatConverter(&pFormatter));
+    THROW_IF_FAILED(pFormatter->Initialize(pFrameDecode.get(), GUID_WICPixelFormat32bppBGRA,
+                                           WICBitmapDitherTypeNone, NULL, 0.0,
+                                           WICBitmapPaletteTypeCustom));
+    THROW_IF_FAILED(
+        pFactory->CreateBitmapFromSource(pFormatter.get(), WICBitmapCacheOnLoad, &pBitmap));
+
+    return pBitmap;
+}
+
+auto getBitmap(IWICImagingFactory* pFactory, IWICBitmapSource* pSource, int size)
+    -> std::vector<char>
+{
+    wil::com_ptr<IWICBitmapEncoder> pEncoder;
+    wil::com_ptr<IWICBitmapFrameEncode> pFrameEncode;
+    wil::com_ptr<IWICBitmapScaler> pScaler;
+    wil::com_ptr<IPropertyBag2> pPropertyBag;
+
     wil::unique_hglobal hglobal;
     wil::com_ptr<IStream> istream;
 
     THROW_IF_FAILED(::CreateStreamOnHGlobal(hglobal.get(), TRUE, &istream));
 
     THROW_IF_FAILED(pFactory->CreateBitmapScaler(&pScaler));
-    THROW_IF_FAILED(pScaler->Initialize(pFrameDecode.get(), size, size,
-                                        WICBitmapInterpolationModeHighQualityCubic));
+    THROW_IF_FAILED(
+        pScaler->Initialize(pSource, size, size, WICBitmapInterpolationModeHighQualityCubic));
 
     UINT bytesPerPixel{4};
     UINT stride{size * bytesPerPixel};
@@ -78,8 +374,26 @@ auto getBitmap(fs::path inputFileCanonical, int size) -> std::vector<char>
     THROW_IF_FAILED(pEncoder->Initialize(istream.get(), WICBitmapEncoderNoCache));
     THROW_IF_FAILED(pEncoder->CreateNewFrame(&pFrameEncode, &pPropertyBag));
 
+    // Pin the encoder configuration so identical input always produces identical bytes. No
+    // metadata, color contexts or thumbnails are written, so the PNG carries no timestamps.
+    std::array<PROPBAG2, 2> encoderOptions{};
+    encoderOptions[0].pstrName = const_cast<LPOLESTR>(L"InterlaceOption");
+    encoderOptions[1].pstrName = const_cast<LPOLESTR>(L"FilterOption");
+
+    std::array<VARIANT, 2> encoderValues;
+    ::VariantInit(&encoderValues[0]);
+    encoderValues[0].vt = VT_BOOL;
+    encoderValues[0].boolVal = VARIANT_FALSE;
+    ::VariantInit(&encoderValues[1]);
+    encoderValues[1].vt = VT_UI1;
+    encoderValues[1].bVal = WICPngFilterAdaptive;
+
+    THROW_IF_FAILED(pPropertyBag->Write(static_cast<ULONG>(encoderOptions.size()),
+                                        encoderOptions.data(), encoderValues.data()));
+
     THROW_IF_FAILED(pFrameEncode->Initialize(pPropertyBag.get()));
     THROW_IF_FAILED(pFrameEncode->SetSize(size, size));
+    THROW_IF_FAILED(pFrameEncode->SetResolution(96.0, 96.0));
 
     WICPixelFormatGUID pixelFormatDestination{GUID_WICPixelFormat32bppBGRA};
     THROW_IF_FAILED(pFrameEncode->SetPixelFormat(&pixelFormatDestination));
@@ -108,7 +422,7 @@ auto getBitmap(fs::path inputFileCanonical, int size) -> std::vector<char>
     return vec;
 }
 
-auto writeHeader(std::ofstream& outputStream, uint16_t count) -> void
+auto writeHeader(std::ostream& outputStream, uint16_t count) -> void
 {
     uint16_t reserved{0};
     uint16_t type{1};
@@ -122,7 +436,7 @@ auto writeHeader(std::ofstream& outputStream, uint16_t count) -> void
     outputStream.write(reinterpret_cast<char*>(&count), sizeof(count));
 }
 
-auto writeEntry(std::ofstream& outputStream, std::vector<char>& bitmap, uint8_t size,
+auto writeEntry(std::ostream& outputStream, std::vector<char>& bitmap, uint8_t size,
                 uint32_t offset) -> void
 {
     uint8_t reserved{0};
@@ -154,7 +468,7 @@ auto writeEntry(std::ofstream& outputStream, std::vector<char>& bitmap, uint8_t
     outputStream.write(reinterpret_cast<char*>(&offset), sizeof(offset));
 }
 
-auto writeBitmap(std::ofstream& outputStream, std::vector<char>& bitmap) -> void
+auto writeBitmap(std::ostream& outputStream, std::vector<char>& bitmap) -> void
 {
     // Write image data. PNG must be stored in its entirety, with file header & must
     // be 32bpp ARGB format.
@@ -162,4 +476,75 @@ auto writeBitmap(std::ofstream& outputStream, std::vector<char>& bitmap) -> void
     auto charSize{static_cast<int64_t>(sizeof(char))};
     outputStream.write(reinterpret_cast<char*>(bitmap.data()), (bitmapSize * charSize));
 }
+
+auto isUnchanged(fs::path outputFile, const std::vector<char>& icon) -> bool
+{
+    std::error_code ec;
+    auto outputFileSize{fs::file_size(outputFile, ec)};
+
+    if (ec || outputFileSize != icon.size())
+    {
+        return false;
+    }
+
+    std::ifstream inputStream(outputFile, std::ios::binary);
+    std::array<char, 64 * 1024> buffer;
+    size_t position{0};
+
+    while (inputStream)
+    {
+        inputStream.read(buffer.data(), buffer.size());
+        auto count{static_cast<size_t>(inputStream.gcount())};
+
+        if (position + count > icon.size() ||
+            !std::equal(buffer.data(), buffer.data() + count, icon.data() + position))
+        {
+            return false;
+        }
+
+        position += count;
+    }
+
+    return position == icon.size();
+}
+
+auto writeIcon(fs::path outputFile, const std::vector<char>& icon, bool writeIfChanged) -> bool
+{
+    if (writeIfChanged && isUnchanged(outputFile, icon))
+    {
+        return false;
+    }
+
+    // Write beside the target and rename over it, so readers never see a partial icon. The
+    // counter keeps concurrent writes to the same output within one process apart.
+    static std::atomic<uint64_t> tempCounter{0};
+    auto tempFile{outputFile};
+    tempFile += std::format(".{}.{}.tmp", ::GetCurrentProcessId(), tempCounter++);
+
+    {
+        std::ofstream outputStream(tempFile, std::ios::binary | std::ios::trunc);
+        outputStream.write(icon.data(), static_cast<std::streamsize>(icon.size()));
+
+        // Closing flushes the buffer, so a full disk only shows up here.
+        outputStream.close();
+
+        if (outputStream.fail())
+        {
+            fs::remove(tempFile);
+            throw std::runtime_error("Writing temporary output file failed");
+        }
+    }
+
+    try
+    {
+        fs::rename(tempFile, outputFile);
+    }
+    catch (const fs::filesystem_error&)
+    {
+        fs::remove(tempFile);
+        throw;
+    }
+
+    return true;
+}
 } // namespace helpers
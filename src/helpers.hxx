@@ -1,20 +1,63 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <expected>
 #include <filesystem>
 #include <fstream>
+#include <ostream>
 #include <string>
 #include <vector>
 
+#include <wincodec.h>
+
+#include <wil/com.h>
+
 namespace fs = std::filesystem;
 
 namespace helpers
 {
-auto getPaths(int argc, char* argv[]) -> std::pair<fs::path, fs::path>;
-auto getBitmap(fs::path inputFileCanonical, int size) -> std::vector<char>;
-auto writeHeader(std::ofstream& outputStream, uint16_t count) -> void;
-auto writeEntry(std::ofstream& outputStream, std::vector<char>& bitmap, uint8_t size,
+inline constexpr std::array<int, 15> bitmapSizes{256, 128, 96, 80, 72, 64, 60, 48,
+                                                 40,  36,  32, 30, 24, 20, 16};
+
+enum class Mode
+{
+    Convert,
+    Serve,
+    Client,
+    Batch,
+};
+
+struct Options
+{
+    Mode mode{Mode::Convert};
+    bool writeIfChanged{false};
+    fs::path socket;
+    int workers{0};
+    uint64_t memoryLimit{0};
+    bool sendBytes{false};
+    int requests{0};
+    int concurrency{1};
+    std::vector<std::string> arguments;
+};
+
+auto getPaths(const Options& options) -> std::pair<fs::path, fs::path>;
+auto getOptions(int argc, char* argv[]) -> Options;
+auto getIcon(fs::path inputFileCanonical) -> std::vector<char>;
+auto getIcon(IWICImagingFactory* pFactory, IWICBitmapSource* pSource) -> std::vector<char>;
+auto getDecoder(IWICImagingFactory* pFactory, fs::path inputFileCanonical)
+    -> wil::com_ptr<IWICBitmapDecoder>;
+auto getDecoder(IWICImagingFactory* pFactory, const std::vector<char>& bytes)
+    -> wil::com_ptr<IWICBitmapDecoder>;
+auto getFootprint(IWICBitmapDecoder* pDecoder) -> uint64_t;
+auto getSource(IWICImagingFactory* pFactory, IWICBitmapDecoder* pDecoder)
+    -> wil::com_ptr<IWICBitmap>;
+auto getBitmap(IWICImagingFactory* pFactory, IWICBitmapSource* pSource, int size)
+    -> std::vector<char>;
+auto writeHeader(std::ostream& outputStream, uint16_t count) -> void;
+auto writeEntry(std::ostream& outputStream, std::vector<char>& bitmap, uint8_t size,
                 uint32_t offset) -> void;
-auto writeBitmap(std::ofstream& outputStream, std::vector<char>& bitmap) -> void;
+auto writeBitmap(std::ostream& outputStream, std::vector<char>& bitmap) -> void;
+auto isUnchanged(fs::path outputFile, const std::vector<char>& icon) -> bool;
+auto writeIcon(fs::path outputFile, const std::vector<char>& icon, bool writeIfChanged) -> bool;
 } // namespace helpers
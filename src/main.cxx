@@ -1,16 +1,29 @@
 #include "helpers.hxx"
+#include "service.hxx"
 
 #include <wil/com.h>
 
-#include <cstdint>
-#include <fstream>
 #include <print>
 
 auto main(int argc, char* argv[]) -> int
 {
     auto coUninitialize{wil::CoInitializeEx()};
 
-    auto [inputFile, outputFile]{helpers::getPaths(argc, argv)};
+    auto options{helpers::getOptions(argc, argv)};
+
+    switch (options.mode)
+    {
+        case helpers::Mode::Serve:
+            return service::serve(options);
+        case helpers::Mode::Client:
+            return service::client(options);
+        case helpers::Mode::Batch:
+            return service::batch(options);
+        case helpers::Mode::Convert:
+            break;
+    }
+
+    auto [inputFile, outputFile]{helpers::getPaths(options)};
 
     if (!fs::exists(inputFile))
     {
@@ -40,53 +53,18 @@ auto main(int argc, char* argv[]) -> int
     std::println("Output file: {}", outputFile.string());
     std::println("Input file canonical: {}", inputFileCanonical.string());
 
-    std::vector<std::vector<char>> bitmaps;
-
-    std::vector<int> bitmapSizes{256, 128, 96, 80, 72, 64, 60, 48, 40, 36, 32, 30, 24, 20, 16};
-    for (auto bitmapSize : bitmapSizes)
-    {
-        bitmaps.push_back(helpers::getBitmap(inputFileCanonical, bitmapSize));
-    }
-
-    std::vector<uint32_t> sizes;
-    sizes.reserve(bitmaps.size());
-    for (auto const& bitmap : bitmaps)
-    {
-        sizes.push_back(static_cast<uint32_t>(bitmap.size()));
-    }
-
-    uint16_t count{static_cast<uint16_t>(bitmapSizes.size())};
-    uint32_t offset{6 + (16 * static_cast<uint32_t>(count))};
+    auto icon{helpers::getIcon(inputFileCanonical)};
 
-    std::vector<uint32_t> positions;
-    positions.push_back(offset);
-    auto cumulate{offset};
-    for (auto i = 0; i < sizes.size(); ++i)
-    {
-        cumulate += sizes[i];
-        positions.push_back(cumulate);
-    }
-
-    std::vector<uint8_t> dimensions;
-    dimensions.reserve(sizes.size());
-    for (const auto& size : sizes)
-    {
-        dimensions.push_back(static_cast<uint8_t>(size));
-    }
-
-    std::ofstream outputStream;
-    outputStream.open(outputFile, std::ios::binary);
-
-    helpers::writeHeader(outputStream, count);
-
-    helpers::writeEntry(outputStream, bitmaps[0], 0, positions[0]);
-    for (int i = 1; i < static_cast<int>(bitmapSizes.size()); i++)
+    try
     {
-        helpers::writeEntry(outputStream, bitmaps[i], dimensions[i], positions[i]);
+        if (!helpers::writeIcon(outputFile, icon, options.writeIfChanged))
+        {
+            std::println("Output file unchanged, skipping write");
+        }
     }
-
-    for (int i = 0; i < static_cast<int>(bitmapSizes.size()); i++)
+    catch (const std::exception& e)
     {
-        helpers::writeBitmap(outputStream, bitmaps[i]);
+        std::println("Output file failure: {}, aborting...", e.what());
+        std::exit(EXIT_FAILURE);
     }
 }
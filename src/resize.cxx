@@ -0,0 +1,268 @@
+#include "resize.hxx"
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+namespace resize
+{
+namespace
+{
+// Catmull-Rom cubic, stretched by the downscale ratio so every source pixel contributes.
+constexpr int radius{2};
+
+constexpr auto cubic(double x) -> double
+{
+    x = x < 0.0 ? -x : x;
+
+    if (x < 1.0)
+    {
+        return (1.5 * x * x * x) - (2.5 * x * x) + 1.0;
+    }
+
+    if (x < 2.0)
+    {
+        return (-0.5 * x * x * x) + (2.5 * x * x) - (4.0 * x) + 2.0;
+    }
+
+    return 0.0;
+}
+
+constexpr auto roundUp(double x) -> int
+{
+    auto i{static_cast<int>(x)};
+    return x > i ? i + 1 : i;
+}
+
+constexpr auto getTaps(int source, int target) -> int
+{
+    auto scale{source > target ? static_cast<double>(source) / target : 1.0};
+    auto taps{roundUp(2.0 * radius * scale) + 1};
+    return taps < source ? taps : source;
+}
+
+// Every output pixel reads exactly `taps` source pixels starting at starts[i]. Windows are
+// clamped inside the source and renormalised, so the kernels never need to bounds check.
+template <typename Weights, typename Starts>
+constexpr auto makeFilter(int source, int target, int taps, Weights& weights, Starts& starts)
+    -> void
+{
+    auto ratio{static_cast<double>(source) / target};
+    auto scale{ratio > 1.0 ? ratio : 1.0};
+
+    for (int i = 0; i < target; i++)
+    {
+        auto center{((i + 0.5) * ratio) - 0.5};
+        auto start{std::clamp(roundUp(center - (radius * scale)), 0, source - taps)};
+
+        // One cubic evaluation per tap keeps the compile-time tables within constexpr limits.
+        double sum{0.0};
+        for (int t = 0; t < taps; t++)
+        {
+            auto weight{cubic((start + t - center) / scale)};
+            weights[(i * taps) + t] = static_cast<float>(weight);
+            sum += weight;
+        }
+
+        if (sum == 0.0)
+        {
+            sum = 1.0;
+        }
+
+        for (int t = 0; t < taps; t++)
+        {
+            weights[(i * taps) + t] = static_cast<float>(weights[(i * taps) + t] / sum);
+        }
+
+        starts[i] = start;
+    }
+}
+
+template <int Source, int Target> struct Filter
+{
+    static constexpr int taps{getTaps(Source, Target)};
+    std::array<float, static_cast<size_t>(Target) * taps> weights{};
+    std::array<int, Target> starts{};
+
+    constexpr Filter()
+    {
+        makeFilter(Source, Target, taps, weights, starts);
+    }
+};
+
+template <int Source, int Target> constexpr Filter<Source, Target> filter{};
+
+auto store(const float* pixels, uint8_t* target, int width) -> void
+{
+    for (int x = 0; x < width; x++)
+    {
+        auto* pixel{pixels + (x * 4)};
+        auto* out{target + (x * 4)};
+        auto alpha{std::clamp(pixel[3], 0.0f, 255.0f)};
+
+        if (alpha <= 0.0f)
+        {
+            std::fill(out, out + 4, uint8_t{0});
+            continue;
+        }
+
+        auto factor{255.0f / alpha};
+        for (int c = 0; c < 3; c++)
+        {
+            out[c] = static_cast<uint8_t>(std::clamp(pixel[c] * factor, 0.0f, 255.0f) + 0.5f);
+        }
+        out[3] = static_cast<uint8_t>(alpha + 0.5f);
+    }
+}
+
+// Taps is the compile-time tap count, or 0 to use the runtime `taps` argument.
+template <int Taps>
+auto horizontal(const uint8_t* source, int sourceWidth, int height, float* target,
+                int targetWidth, const float* weights, const int* starts, int taps) -> void
+{
+    const auto n{Taps > 0 ? Taps : taps};
+
+    for (int y = 0; y < height; y++)
+    {
+        auto* row{source + (static_cast<size_t>(y) * sourceWidth * 4)};
+        auto* out{target + (static_cast<size_t>(y) * targetWidth * 4)};
+
+        for (int x = 0; x < targetWidth; x++)
+        {
+            auto* pixel{row + (starts[x] * 4)};
+            auto* weight{weights + (x * n)};
+            float b{0.0f};
+            float g{0.0f};
+            float r{0.0f};
+            float a{0.0f};
+
+            for (int t = 0; t < n; t++)
+            {
+                b += weight[t] * pixel[(t * 4) + 0];
+                g += weight[t] * pixel[(t * 4) + 1];
+                r += weight[t] * pixel[(t * 4) + 2];
+                a += weight[t] * pixel[(t * 4) + 3];
+            }
+
+            out[(x * 4) + 0] = b;
+            out[(x * 4) + 1] = g;
+            out[(x * 4) + 2] = r;
+            out[(x * 4) + 3] = a;
+        }
+    }
+}
+
+template <int Taps>
+auto vertical(const float* source, int width, uint8_t* target, int targetHeight,
+              const float* weights, const int* starts, int taps) -> void
+{
+    const auto n{Taps > 0 ? Taps : taps};
+    const auto rowSize{static_cast<size_t>(width) * 4};
+    std::vector<float> accumulator(rowSize);
+
+    for (int y = 0; y < targetHeight; y++)
+    {
+        std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+        auto* weight{weights + (y * n)};
+
+        for (int t = 0; t < n; t++)
+        {
+            auto* row{source + (static_cast<size_t>(starts[y] + t) * rowSize)};
+            for (size_t i = 0; i < rowSize; i++)
+            {
+                accumulator[i] += weight[t] * row[i];
+            }
+        }
+
+        store(accumulator.data(), target + (static_cast<size_t>(y) * rowSize), width);
+    }
+}
+
+template <int Source, int Target> auto scaleFixed(const Image& source) -> Image
+{
+    constexpr auto& f{filter<Source, Target>};
+    constexpr auto taps{Filter<Source, Target>::taps};
+
+    std::vector<float> rows(static_cast<size_t>(Source) * Target * 4);
+    horizontal<taps>(source.pixels.data(), Source, Source, rows.data(), Target, f.weights.data(),
+                     f.starts.data(), taps);
+
+    Image target{Target, Target, std::vector<uint8_t>(static_cast<size_t>(Target) * Target * 4)};
+    vertical<taps>(rows.data(), Target, target.pixels.data(), Target, f.weights.data(),
+                   f.starts.data(), taps);
+
+    return target;
+}
+
+template <int Source, size_t... I>
+auto scaleFrom(const Image& source, int size, Image& target, std::index_sequence<I...>) -> bool
+{
+    return ((size == standardSizes[I] &&
+             (target = scaleFixed<Source, standardSizes[I]>(source), true)) ||
+            ...);
+}
+} // namespace
+
+auto isSpecialised(const Image& source, int size) -> bool
+{
+    return source.width == source.height &&
+           std::ranges::find(standardSources, source.width) != standardSources.end() &&
+           std::ranges::find(standardSizes, size) != standardSizes.end();
+}
+
+auto scale(const Image& source, int size) -> Image
+{
+    if (isSpecialised(source, size))
+    {
+        Image target;
+        constexpr auto sizes{std::make_index_sequence<standardSizes.size()>()};
+
+        switch (source.width)
+        {
+            case 256:
+                if (scaleFrom<256>(source, size, target, sizes))
+                {
+                    return target;
+                }
+                break;
+            case 512:
+                if (scaleFrom<512>(source, size, target, sizes))
+                {
+                    return target;
+                }
+                break;
+            case 1024:
+                if (scaleFrom<1024>(source, size, target, sizes))
+                {
+                    return target;
+                }
+                break;
+        }
+    }
+
+    return scaleGeneric(source, size);
+}
+
+auto scaleGeneric(const Image& source, int size) -> Image
+{
+    auto horizontalTaps{getTaps(source.width, size)};
+    std::vector<float> horizontalWeights(static_cast<size_t>(size) * horizontalTaps);
+    std::vector<int> horizontalStarts(size);
+    makeFilter(source.width, size, horizontalTaps, horizontalWeights, horizontalStarts);
+
+    auto verticalTaps{getTaps(source.height, size)};
+    std::vector<float> verticalWeights(static_cast<size_t>(size) * verticalTaps);
+    std::vector<int> verticalStarts(size);
+    makeFilter(source.height, size, verticalTaps, verticalWeights, verticalStarts);
+
+    std::vector<float> rows(static_cast<size_t>(source.height) * size * 4);
+    horizontal<0>(source.pixels.data(), source.width, source.height, rows.data(), size,
+                  horizontalWeights.data(), horizontalStarts.data(), horizontalTaps);
+
+    Image target{size, size, std::vector<uint8_t>(static_cast<size_t>(size) * size * 4)};
+    vertical<0>(rows.data(), size, target.pixels.data(), size, verticalWeights.data(),
+                verticalStarts.data(), verticalTaps);
+
+    return target;
+}
+} // namespace resize
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Hand-written separable Catmull-Rom resamplers. The converter scales with WIC, these are only
+// built into IconConverterBench to compare against it.
+namespace resize
+{
+// Pixels are 32bpp BGRA, premultiplied on input to scale and straight on output.
+struct Image
+{
+    int width{0};
+    int height{0};
+    std::vector<uint8_t> pixels;
+};
+
+inline constexpr std::array<int, 15> standardSizes{256, 128, 96, 80, 72, 64, 60, 48,
+                                                   40,  36,  32, 30, 24, 20, 16};
+inline constexpr std::array<int, 3> standardSources{256, 512, 1024};
+
+auto isSpecialised(const Image& source, int size) -> bool;
+auto scale(const Image& source, int size) -> Image;
+auto scaleGeneric(const Image& source, int size) -> Image;
+} // namespace resize
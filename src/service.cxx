@@ -0,0 +1,726 @@
+// Winsock must be included before Windows.h, which helpers.hxx pulls in via wincodec.h.
+#include <winsock2.h>
+#include <afunix.h>
+
+#include "service.hxx"
+
+#include <psapi.h>
+
+#include <wil/com.h>
+#include <wil/resource.h>
+#include <wil/result.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <format>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <print>
+#include <semaphore>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace service
+{
+namespace
+{
+constexpr uint32_t maximumLength{256 * 1024 * 1024};
+constexpr size_t chunkSize{64 * 1024};
+constexpr ptrdiff_t maximumConnections{64};
+
+struct Response
+{
+    Status status{Status::Ok};
+    std::vector<char> bytes;
+    // Budget admitted for the job, for callers that release it themselves.
+    uint64_t footprint{0};
+};
+
+struct Job
+{
+    Kind kind{Kind::Path};
+    std::vector<char> payload;
+    std::promise<Response> response;
+    // Estimated peak bytes, taken from the image header when the job is submitted.
+    uint64_t footprint{0};
+    // Batch jobs write the icon from the worker, so it is released with the job's budget.
+    fs::path outputFile;
+    bool writeIfChanged{false};
+    // Serve keeps the icon until it is sent, so the connection releases the budget instead.
+    bool releaseByWorker{true};
+};
+
+// Estimated bytes held by admitted jobs. A limit of 0 disables admission control.
+struct Budget
+{
+    uint64_t limit{0};
+    uint64_t used{0};
+    uint64_t peak{0};
+    // Jobs being converted. Memory counted elsewhere, such as queued payloads, can keep used
+    // above zero, so progress depends on this count instead.
+    size_t running{0};
+};
+
+// The budget shares the queue's lock. Workers only admit the job at the head of the queue, so
+// admission is FIFO. Once the head is waiting for budget, nothing behind it overtakes it.
+// When no job is being converted, the head is always admitted, so a job larger than the whole
+// limit still runs.
+struct Queue
+{
+    std::mutex mutex;
+    std::condition_variable_any condition;
+    std::deque<Job> jobs;
+    Budget budget;
+};
+
+// Shared with the detached connection threads, so it outlives them. The WIC factory is
+// free-threaded, connection threads share it to read image headers in submit.
+struct Server
+{
+    Queue queue;
+    wil::com_ptr<IWICImagingFactory> pFactory;
+    std::counting_semaphore<maximumConnections> connections{maximumConnections};
+};
+
+auto isAdmissible(const Budget& budget, uint64_t bytes) -> bool
+{
+    return budget.limit == 0 || budget.running == 0 || budget.used + bytes <= budget.limit;
+}
+
+// Counts memory held outside the workers, such as received request payloads. It is not
+// admitted, but it holds back admissions until it is released.
+auto charge(Queue& queue, uint64_t bytes) -> void
+{
+    std::scoped_lock lock(queue.mutex);
+    queue.budget.used += bytes;
+    queue.budget.peak = std::max(queue.budget.peak, queue.budget.used);
+}
+
+auto release(Queue& queue, uint64_t bytes) -> void
+{
+    {
+        std::scoped_lock lock(queue.mutex);
+        queue.budget.used -= bytes;
+    }
+
+    queue.condition.notify_all();
+}
+
+auto startup() -> void
+{
+    WSADATA wsaData;
+
+    if (auto error{::WSAStartup(MAKEWORD(2, 2), &wsaData)}; error != 0)
+    {
+        throw std::runtime_error(std::format("WSAStartup failed: {}", error));
+    }
+}
+
+auto getAddress(const fs::path& socket) -> sockaddr_un
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    auto path{socket.string()};
+
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("Socket path too long");
+    }
+
+    std::copy(path.begin(), path.end(), address.sun_path);
+
+    return address;
+}
+
+auto sendAll(SOCKET socket, const char* data, size_t size) -> void
+{
+    while (size > 0)
+    {
+        auto sent{::send(socket, data, static_cast<int>(std::min(size, chunkSize)), 0)};
+
+        if (sent == SOCKET_ERROR)
+        {
+            throw std::runtime_error(std::format("send failed: {}", ::WSAGetLastError()));
+        }
+
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+}
+
+// Returns false if the peer closed the connection before any byte was read.
+auto receiveAll(SOCKET socket, char* data, size_t size) -> bool
+{
+    size_t received{0};
+
+    while (received < size)
+    {
+        auto count{::recv(socket, data + received,
+                          static_cast<int>(std::min(size - received, chunkSize)), 0)};
+
+        if (count == 0 && received == 0)
+        {
+            return false;
+        }
+
+        if (count <= 0)
+        {
+            throw std::runtime_error(std::format("recv failed: {}", ::WSAGetLastError()));
+        }
+
+        received += static_cast<size_t>(count);
+    }
+
+    return true;
+}
+
+auto connectTo(const fs::path& socket) -> wil::unique_socket
+{
+    wil::unique_socket connection{::socket(AF_UNIX, SOCK_STREAM, 0)};
+
+    if (!connection)
+    {
+        throw std::runtime_error(std::format("socket failed: {}", ::WSAGetLastError()));
+    }
+
+    auto address{getAddress(socket)};
+
+    if (::connect(connection.get(), reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+        SOCKET_ERROR)
+    {
+        throw std::runtime_error(std::format("connect failed: {}", ::WSAGetLastError()));
+    }
+
+    return connection;
+}
+
+auto listen(const fs::path& socket) -> wil::unique_socket
+{
+    wil::unique_socket listener{::socket(AF_UNIX, SOCK_STREAM, 0)};
+
+    if (!listener)
+    {
+        throw std::runtime_error(std::format("socket failed: {}", ::WSAGetLastError()));
+    }
+
+    // A stale socket file from a previous run would make bind fail.
+    std::error_code ec;
+    fs::remove(socket, ec);
+
+    auto address{getAddress(socket)};
+
+    if (::bind(listener.get(), reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+        SOCKET_ERROR)
+    {
+        throw std::runtime_error(std::format("bind failed: {}", ::WSAGetLastError()));
+    }
+
+    if (::listen(listener.get(), SOMAXCONN) == SOCKET_ERROR)
+    {
+        throw std::runtime_error(std::format("listen failed: {}", ::WSAGetLastError()));
+    }
+
+    return listener;
+}
+
+auto request(SOCKET connection, Kind kind, const std::vector<char>& payload) -> Response
+{
+    RequestHeader requestHeader{kind, static_cast<uint32_t>(payload.size())};
+    sendAll(connection, reinterpret_cast<char*>(&requestHeader), sizeof(requestHeader));
+    sendAll(connection, payload.data(), payload.size());
+
+    ResponseHeader responseHeader;
+    if (!receiveAll(connection, reinterpret_cast<char*>(&responseHeader), sizeof(responseHeader)))
+    {
+        throw std::runtime_error("Server closed the connection");
+    }
+
+    Response response{responseHeader.status, std::vector<char>(responseHeader.length)};
+    if (!receiveAll(connection, response.bytes.data(), response.bytes.size()))
+    {
+        throw std::runtime_error("Connection closed");
+    }
+
+    return response;
+}
+
+auto getDecoder(IWICImagingFactory* pFactory, const Job& job) -> wil::com_ptr<IWICBitmapDecoder>
+{
+    switch (job.kind)
+    {
+        case Kind::Path:
+            return helpers::getDecoder(
+                pFactory, fs::path(std::u8string(job.payload.begin(), job.payload.end())));
+        case Kind::Bytes:
+            return helpers::getDecoder(pFactory, job.payload);
+        default:
+            throw std::runtime_error("Unknown request kind");
+    }
+}
+
+auto convert(IWICImagingFactory* pFactory, const Job& job) -> Response
+{
+    try
+    {
+        auto pDecoder{getDecoder(pFactory, job)};
+        auto pSource{helpers::getSource(pFactory, pDecoder.get())};
+        auto icon{helpers::getIcon(pFactory, pSource.get())};
+
+        if (!job.outputFile.empty())
+        {
+            helpers::writeIcon(job.outputFile, icon, job.writeIfChanged);
+            return {Status::Ok, {}};
+        }
+
+        return {Status::Ok, std::move(icon)};
+    }
+    catch (const std::exception& e)
+    {
+        std::string message{e.what()};
+        return {Status::Error, std::vector<char>(message.begin(), message.end())};
+    }
+}
+
+auto work(Queue& queue, std::stop_token token) -> void
+{
+    auto coUninitialize{wil::CoInitializeEx()};
+
+    auto pFactory{
+        wil::CoCreateInstance<IWICImagingFactory>(CLSID_WICImagingFactory, CLSCTX_INPROC_SERVER)};
+
+    while (!token.stop_requested())
+    {
+        Job job;
+
+        {
+            std::unique_lock lock(queue.mutex);
+
+            // Jobs waiting for budget stay queued, so they never hold a worker.
+            if (!queue.condition.wait(lock, token,
+                                      [&]
+                                      {
+                                          return !queue.jobs.empty() &&
+                                                 isAdmissible(queue.budget,
+                                                              queue.jobs.front().footprint);
+                                      }))
+            {
+                return;
+            }
+
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+
+            queue.budget.used += job.footprint;
+            queue.budget.peak = std::max(queue.budget.peak, queue.budget.used);
+            queue.budget.running++;
+        }
+
+        auto response{convert(pFactory.get(), job)};
+        response.footprint = job.footprint;
+
+        {
+            std::scoped_lock lock(queue.mutex);
+            queue.budget.running--;
+
+            if (job.releaseByWorker)
+            {
+                queue.budget.used -= job.footprint;
+            }
+        }
+
+        queue.condition.notify_all();
+        job.response.set_value(std::move(response));
+    }
+}
+
+// Estimates the job's footprint from the image header before it is queued. If the header
+// cannot be read, the job is queued with no footprint and the worker reports the error.
+auto submit(Queue& queue, IWICImagingFactory* pFactory, Job job) -> std::future<Response>
+{
+    try
+    {
+        auto pDecoder{getDecoder(pFactory, job)};
+        job.footprint = helpers::getFootprint(pDecoder.get());
+    }
+    catch (const std::exception& e)
+    {
+        job.footprint = 0;
+    }
+
+    auto future{job.response.get_future()};
+
+    {
+        std::scoped_lock lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+
+    queue.condition.notify_one();
+
+    return future;
+}
+
+auto startPool(Queue& queue, const helpers::Options& options) -> std::vector<std::jthread>
+{
+    auto workers{options.workers > 0 ? static_cast<size_t>(options.workers)
+                                     : std::max(1u, std::thread::hardware_concurrency())};
+
+    queue.budget.limit = options.memoryLimit;
+
+    std::vector<std::jthread> pool;
+
+    for (size_t i = 0; i < workers; i++)
+    {
+        pool.emplace_back([&queue](std::stop_token token) { work(queue, token); });
+    }
+
+    return pool;
+}
+
+auto handle(std::shared_ptr<Server> server, wil::unique_socket connection) -> void
+{
+    auto releaseConnection{wil::scope_exit([&] { server->connections.release(); })};
+
+    try
+    {
+        auto coUninitialize{wil::CoInitializeEx()};
+
+        RequestHeader requestHeader;
+
+        while (receiveAll(connection.get(), reinterpret_cast<char*>(&requestHeader),
+                          sizeof(requestHeader)))
+        {
+            if (requestHeader.length > maximumLength)
+            {
+                throw std::runtime_error("Request too large");
+            }
+
+            // The payload is counted before it is allocated. It stays counted, along with the
+            // job's footprint, until the response has been sent.
+            uint64_t charged{requestHeader.length};
+            charge(server->queue, charged);
+            auto releaseCharged{wil::scope_exit([&] { release(server->queue, charged); })};
+
+            Job job{requestHeader.kind, std::vector<char>(requestHeader.length)};
+            job.releaseByWorker = false;
+
+            if (!receiveAll(connection.get(), job.payload.data(), job.payload.size()))
+            {
+                throw std::runtime_error("Connection closed");
+            }
+
+            auto response{submit(server->queue, server->pFactory.get(), std::move(job)).get()};
+            charged += response.footprint;
+
+            ResponseHeader responseHeader{response.status,
+                                          static_cast<uint32_t>(response.bytes.size())};
+            sendAll(connection.get(), reinterpret_cast<char*>(&responseHeader),
+                    sizeof(responseHeader));
+            sendAll(connection.get(), response.bytes.data(), response.bytes.size());
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::println("Connection failure: {}", e.what());
+    }
+}
+
+auto bench(const helpers::Options& options, Kind kind, const std::vector<char>& payload) -> int
+{
+    auto concurrency{static_cast<size_t>(options.concurrency)};
+    std::vector<std::vector<double>> latencies(concurrency);
+    std::atomic<int> failures{0};
+
+    auto start{std::chrono::steady_clock::now()};
+
+    {
+        std::vector<std::jthread> threads;
+
+        for (size_t t = 0; t < concurrency; t++)
+        {
+            auto count{(options.requests / options.concurrency) +
+                       (static_cast<int>(t) < options.requests % options.concurrency ? 1 : 0)};
+
+            threads.emplace_back(
+                [&, t, count]
+                {
+                    try
+                    {
+                        auto connection{connectTo(options.socket)};
+
+                        for (int i = 0; i < count; i++)
+                        {
+                            auto begin{std::chrono::steady_clock::now()};
+                            auto response{request(connection.get(), kind, payload)};
+                            std::chrono::duration<double, std::milli> latency{
+                                std::chrono::steady_clock::now() - begin};
+
+                            latencies[t].push_back(latency.count());
+
+                            if (response.status != Status::Ok)
+                            {
+                                failures++;
+                            }
+                        }
+                    }
+                    catch (const std::exception& e)
+                    {
+                        std::println("Client failure: {}", e.what());
+                        failures++;
+                    }
+                });
+        }
+    }
+
+    std::chrono::duration<double> elapsed{std::chrono::steady_clock::now() - start};
+
+    std::vector<double> all;
+    for (const auto& latency : latencies)
+    {
+        all.insert(all.end(), latency.begin(), latency.end());
+    }
+
+    if (all.empty())
+    {
+        std::println("No requests completed");
+        return EXIT_FAILURE;
+    }
+
+    std::ranges::sort(all);
+
+    // Nearest rank, the smallest sample with at least p of the samples at or below it.
+    auto percentile{[&](double p)
+                    {
+                        auto rank{static_cast<size_t>(std::ceil(p * all.size()))};
+                        return all[std::clamp(rank, size_t{1}, all.size()) - 1];
+                    }};
+
+    std::println("Requests: {}, concurrency: {}, failures: {}", all.size(), concurrency,
+                 failures.load());
+    std::println("p50: {:.2f} ms, p99: {:.2f} ms, throughput: {:.1f} req/s", percentile(0.50),
+                 percentile(0.99), static_cast<double>(all.size()) / elapsed.count());
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+} // namespace
+
+auto serve(const helpers::Options& options) -> int
+{
+    auto wsaCleanup{wil::scope_exit([] { ::WSACleanup(); })};
+    std::optional<wil::unique_socket> listener;
+    auto server{std::make_shared<Server>()};
+
+    try
+    {
+        startup();
+        listener = listen(options.socket);
+        server->pFactory = wil::CoCreateInstance<IWICImagingFactory>(CLSID_WICImagingFactory,
+                                                                     CLSCTX_INPROC_SERVER);
+    }
+    catch (const std::exception& e)
+    {
+        std::println("Serve failure: {}, aborting...", e.what());
+        return EXIT_FAILURE;
+    }
+
+    auto pool{startPool(server->queue, options)};
+
+    std::println("Listening on {} with {} workers", options.socket.string(), pool.size());
+
+    for (;;)
+    {
+        // At the connection cap, further clients wait in the listen backlog.
+        server->connections.acquire();
+
+        wil::unique_socket connection{::accept(listener->get(), NULL, NULL)};
+
+        if (!connection)
+        {
+            auto error{::WSAGetLastError()};
+            server->connections.release();
+
+            switch (error)
+            {
+                case WSAECONNRESET:
+                case WSAEINTR:
+                    continue;
+                case WSAEMFILE:
+                case WSAENOBUFS:
+                    // Out of sockets or buffers, wait for connections to close.
+                    std::println("accept failed: {}, retrying...", error);
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                    continue;
+                default:
+                    std::println("accept failed: {}, aborting...", error);
+                    return EXIT_FAILURE;
+            }
+        }
+
+        std::thread(handle, server, std::move(connection)).detach();
+    }
+}
+
+auto batch(const helpers::Options& options) -> int
+{
+    const auto& args{options.arguments};
+
+    if (args.empty() || args.size() % 2 != 0)
+    {
+        std::println("Batch expects input and output file pairs");
+        return EXIT_FAILURE;
+    }
+
+    auto pFactory{
+        wil::CoCreateInstance<IWICImagingFactory>(CLSID_WICImagingFactory, CLSCTX_INPROC_SERVER)};
+
+    Queue queue;
+    auto pool{startPool(queue, options)};
+
+    std::vector<std::pair<fs::path, std::future<Response>>> results;
+    int failures{0};
+
+    for (size_t i = 0; i < args.size(); i += 2)
+    {
+        fs::path inputFile{args[i]};
+        std::error_code ec;
+        auto inputFileCanonical{fs::canonical(inputFile, ec)};
+
+        if (ec)
+        {
+            std::println("{}: Input file failure: {}", inputFile.string(), ec.message());
+            failures++;
+            continue;
+        }
+
+        auto path{inputFileCanonical.u8string()};
+        Job job{Kind::Path, std::vector<char>(path.begin(), path.end())};
+        job.outputFile = args[i + 1];
+        job.writeIfChanged = options.writeIfChanged;
+
+        results.emplace_back(inputFile, submit(queue, pFactory.get(), std::move(job)));
+    }
+
+    for (auto& [inputFile, future] : results)
+    {
+        auto response{future.get()};
+
+        if (response.status != Status::Ok)
+        {
+            std::println("{}: Conversion failure: {}", inputFile.string(),
+                         std::string(response.bytes.begin(), response.bytes.end()));
+            failures++;
+        }
+    }
+
+    PROCESS_MEMORY_COUNTERS counters{};
+    counters.cb = sizeof(counters);
+    ::GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters));
+
+    std::println("Jobs: {}, failures: {}", args.size() / 2, failures);
+    uint64_t peak{0};
+
+    {
+        std::scoped_lock lock(queue.mutex);
+        peak = queue.budget.peak;
+    }
+
+    std::println("Peak admitted estimate: {} MiB, limit: {}", peak >> 20,
+                 options.memoryLimit > 0 ? std::format("{} MiB", options.memoryLimit >> 20)
+                                         : std::string("none"));
+    std::println("Peak process commit: {} MiB, peak working set: {} MiB",
+                 counters.PeakPagefileUsage >> 20, counters.PeakWorkingSetSize >> 20);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+auto client(const helpers::Options& options) -> int
+{
+    if (options.arguments.empty())
+    {
+        std::println("No input file specified");
+        return EXIT_FAILURE;
+    }
+
+    auto wsaCleanup{wil::scope_exit([] { ::WSACleanup(); })};
+
+    try
+    {
+        startup();
+    }
+    catch (const std::exception& e)
+    {
+        std::println("Client failure: {}, aborting...", e.what());
+        return EXIT_FAILURE;
+    }
+
+    fs::path inputFile{options.arguments.front()};
+    std::vector<char> payload;
+    Kind kind{options.sendBytes ? Kind::Bytes : Kind::Path};
+
+    try
+    {
+        if (options.sendBytes)
+        {
+            std::ifstream inputStream(inputFile, std::ios::binary);
+            payload.assign(std::istreambuf_iterator<char>(inputStream),
+                           std::istreambuf_iterator<char>());
+
+            if (!inputStream)
+            {
+                throw std::runtime_error("Reading input file failed");
+            }
+        }
+        else
+        {
+            auto path{fs::canonical(inputFile).u8string()};
+            payload.assign(path.begin(), path.end());
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::println("Input file failure: {}, aborting...", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (options.requests > 0)
+    {
+        return bench(options, kind, payload);
+    }
+
+    auto [_, outputFile]{helpers::getPaths(options)};
+
+    try
+    {
+        auto connection{connectTo(options.socket)};
+        auto response{request(connection.get(), kind, payload)};
+
+        if (response.status != Status::Ok)
+        {
+            std::println("Conversion failure: {}, aborting...",
+                         std::string(response.bytes.begin(), response.bytes.end()));
+            return EXIT_FAILURE;
+        }
+
+        if (!helpers::writeIcon(outputFile, response.bytes, options.writeIfChanged))
+        {
+            std::println("Output file unchanged, skipping write");
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::println("Client failure: {}, aborting...", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+} // namespace service
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "helpers.hxx"
+
+#include <cstdint>
+#include <vector>
+
+namespace service
+{
+// Wire format, little-endian. A request is a RequestHeader followed by `length` bytes of
+// either a UTF-8 input path or the encoded input image. A response is a ResponseHeader
+// followed by `length` bytes of ICO data, or a UTF-8 error message when status is Error.
+enum class Kind : uint32_t
+{
+    Path = 0,
+    Bytes = 1,
+};
+
+enum class Status : uint32_t
+{
+    Ok = 0,
+    Error = 1,
+};
+
+struct RequestHeader
+{
+    Kind kind{Kind::Path};
+    uint32_t length{0};
+};
+
+struct ResponseHeader
+{
+    Status status{Status::Ok};
+    uint32_t length{0};
+};
+
+auto serve(const helpers::Options& options) -> int;
+auto batch(const helpers::Options& options) -> int;
+auto client(const helpers::Options& options) -> int;
+} // namespace service